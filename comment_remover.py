@@ -0,0 +1,97 @@
+import re
+
+# 普通状态下需要识别的记号: 行注释, 块注释开始, 字符串和字符常量(可能没有闭合)
+TOKEN = re.compile(r'//|/\*|"(?:\\.|[^"\\])*"?|\'(?:\\.|[^\'\\])*\'?')
+BLOCK_END = re.compile(r'\*/')
+IDENT_CHAR = re.compile(r'\w')
+# hunk 头 @@ -a,b +c,d @@, 后面可能跟着 git 给出的函数名那一行
+HUNK_HEADER = re.compile(r'@@[^@\n]*@@')
+
+
+class CommentStripper:
+    """删除一份 C/C++ 代码里的注释, 按行输入, 块注释的状态跨行保留"""
+
+    def __init__(self):
+        self.in_block = False
+
+    def reset(self):
+        self.in_block = False
+
+    def strip(self, line):
+        out = []
+        pos = 0
+        # 注释去掉以后, 两边如果都是标识符字符就补一个空格, 避免 a/**/b 变成 ab
+        joined = False
+        while pos < len(line):
+            if self.in_block:
+                end = BLOCK_END.search(line, pos)
+                if end is None:
+                    return ''.join(out)
+                pos = end.end()
+                self.in_block = False
+                joined = True
+                continue
+
+            m = TOKEN.search(line, pos)
+            if m is None:
+                out.append(self._join(out, line[pos:], joined))
+                break
+            out.append(self._join(out, line[pos:m.start()], joined))
+            joined = False
+            token = m.group()
+            if token == '//':
+                break
+            if token == '/*':
+                self.in_block = True
+                pos = m.end()
+                continue
+            # 字符串或字符常量原样保留, 里面的 /* 和 // 不是注释
+            out.append(token)
+            pos = m.end()
+        return ''.join(out)
+
+    @staticmethod
+    def _join(out, text, joined):
+        if joined and text and IDENT_CHAR.match(text[0]):
+            prev = ''.join(out)[-1:]
+            if prev and IDENT_CHAR.match(prev):
+                return ' ' + text
+        return text
+
+
+def remove_comments(patch):
+    """删除 diff 文本中的注释, 保留每行开头的 +/-/空格 和 @@ 行
+
+    diff 里旧代码是 上下文+'-' 行, 新代码是 上下文+'+' 行, 两边各用一个状态,
+    这样跨越多行(包括跨越 +/- 行)的块注释也能正确处理.
+    如果两边对同一个上下文行的结果不同(比如 '-' 行打开的块注释在上下文行里才结束),
+    这一行拆成 '-' 旧代码 和 '+' 新代码 两行
+    """
+    old = CommentStripper()
+    new = CommentStripper()
+    lines = []
+    for line in patch.split('\n'):
+        if line.startswith('@@'):
+            # 新的 hunk 和上一个不连续
+            old.reset()
+            new.reset()
+            # @@ 后面的函数名那一行单独去注释, 和 diff 的两边都无关
+            m = HUNK_HEADER.match(line)
+            end = m.end() if m else len(line)
+            lines.append(line[:end] + CommentStripper().strip(line[end:]))
+        elif line.startswith('-'):
+            lines.append('-' + old.strip(line[1:]))
+        elif line.startswith('+'):
+            lines.append('+' + new.strip(line[1:]))
+        elif line.startswith('\\'):
+            # "\ No newline at end of file"
+            lines.append(line)
+        else:
+            marker, code = line[:1], line[1:]
+            old_code, new_code = old.strip(code), new.strip(code)
+            if old_code == new_code:
+                lines.append(marker + new_code)
+            else:
+                lines.append('-' + old_code)
+                lines.append('+' + new_code)
+    return '\n'.join(lines)
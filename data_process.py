@@ -5,6 +5,8 @@
 import gzip
 import os
 import json
+from multiprocessing import Pool
+
 import numpy as np
 from more_itertools import chunked
 
@@ -18,46 +20,73 @@ def format_str(string):
     return string
 
 
-def preprocess_test_data(language, test_batch_size=1000):
-    path = os.path.join(DATA_DIR, '{}_test_0.jsonl.gz'.format(language))
+# 每条记录在一个batch里只解析一次: (url, doc_token, code_token)
+def parse_record(raw):
+    line = json.loads(str(raw, encoding='utf-8'))
+    doc_token = ' '.join(line['docstring_tokens'])
+    code_token = ' '.join([format_str(token) for token in line['code_tokens']])
+    return line['url'], doc_token, code_token
+
+
+# 逐行生成 batch 内的 1000x1000 配对, 不在内存里拼出整个 batch
+def generate_pairs(records):
+    for url_a, doc_token, _ in records:
+        for url_b, _, code_token in records:
+            yield '<CODESPLIT>'.join((str(1), url_a, url_b, doc_token, code_token))
+
+
+# 目录放在任务里传给子进程: spawn/forkserver 启动的子进程看不到父进程里改过的 DATA_DIR
+def write_batch(task):
+    data_dir, language, batch_idx, batch_data = task
+    records = [parse_record(d) for d in batch_data]
+
+    data_path = os.path.join(data_dir, 'test/{}'.format(language))
+    os.makedirs(data_path, exist_ok=True)
+    file_path = os.path.join(data_path, 'batch_{}.txt'.format(batch_idx))
+    with open(file_path, 'w', encoding='utf-8') as f:
+        # 和原来的 '\n'.join(examples) 一致: 行之间有换行, 文件末尾没有
+        sep = ''
+        for example in generate_pairs(records):
+            f.write(sep)
+            f.write(example)
+            sep = '\n'
+    return file_path
+
+
+def batch_tasks(language, test_batch_size=1000, data_dir=None):
+    data_dir = DATA_DIR if data_dir is None else data_dir
+    path = os.path.join(data_dir, '{}_test_0.jsonl.gz'.format(language))
     print(path)
     with gzip.open(path, 'r') as pf:
         data = pf.readlines()
 
     idxs = np.arange(len(data))
-    data = np.array(data, dtype=np.object)
 
     np.random.seed(0)  # set random seed so that random things are reproducible
     np.random.shuffle(idxs)
-    data = data[idxs]
+    data = [data[i] for i in idxs]
     batched_data = chunked(data, test_batch_size)
 
-    print("start processing")
     for batch_idx, batch_data in enumerate(batched_data):
         if len(batch_data) < test_batch_size:
             break  # the last batch is smaller than the others, exclude.
-        examples = []
-        for d_idx, d in enumerate(batch_data):
-            line_a = json.loads(str(d, encoding='utf-8'))
-            doc_token = ' '.join(line_a['docstring_tokens'])
-            for dd in batch_data:
-                line_b = json.loads(str(dd, encoding='utf-8'))
-                code_token = ' '.join([format_str(token) for token in line_b['code_tokens']])
-
-                example = (str(1), line_a['url'], line_b['url'], doc_token, code_token)
-                example = '<CODESPLIT>'.join(example)
-                examples.append(example)
-
-        data_path = os.path.join(DATA_DIR, 'test/{}'.format(language))
-        if not os.path.exists(data_path):
-            os.makedirs(data_path)
-        file_path = os.path.join(data_path, 'batch_{}.txt'.format(batch_idx))
-        print(file_path)
-        with open(file_path, 'w', encoding='utf-8') as f:
-            f.writelines('\n'.join(examples))
+        yield data_dir, language, batch_idx, batch_data
+
+
+def preprocess_test_data(language, test_batch_size=1000, workers=None, data_dir=None):
+    preprocess_languages([language], test_batch_size, workers, data_dir)
+
+
+# 多种语言一起处理, 所有语言的 batch 共用一个进程池
+def preprocess_languages(languages, test_batch_size=1000, workers=None, data_dir=None):
+    tasks = (task for lang in languages for task in batch_tasks(lang, test_batch_size, data_dir))
+    print("start processing")
+    # batch 之间互不依赖, 按语言和 batch 分给多个进程
+    with Pool(workers) as pool:
+        for file_path in pool.imap_unordered(write_batch, tasks):
+            print(file_path)
 
 
 if __name__ == '__main__':
     languages = ['go', 'php', 'python', 'java', 'javascript', 'ruby']
-    for lang in languages:
-        preprocess_test_data(lang)
+    preprocess_languages(languages)
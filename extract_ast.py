@@ -0,0 +1,400 @@
+import argparse
+import glob
+import gzip
+import hashlib
+import inspect
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+from multiprocessing import Pool
+
+import pycparser
+from pycparser import c_ast, c_parser
+
+from comment_remover import CommentStripper
+
+# 批量提取 sources_edited / targets_edited 中 BUG_xxx(n) / FIX_xxx(n) 标注所在的函数的 AST
+# 只解析包含标注的函数, 按文件内容 hash 缓存, 输出压缩的 json lines
+
+# 输出格式有变化时加一, 旧的缓存和输出就不会被误用
+FORMAT_VERSION = 1
+
+# 代替 glib / wireshark 头文件: 常见类型和会让 pycparser 出错的宏
+FAKE_HEADER = r'''
+typedef int gint; typedef unsigned int guint; typedef int gboolean; typedef char gchar;
+typedef unsigned char guchar; typedef signed char gint8; typedef unsigned char guint8;
+typedef short gint16; typedef unsigned short guint16; typedef int gint32; typedef unsigned int guint32;
+typedef long long gint64; typedef unsigned long long guint64; typedef long glong; typedef unsigned long gulong;
+typedef short gshort; typedef unsigned short gushort; typedef float gfloat; typedef double gdouble;
+typedef void *gpointer; typedef const void *gconstpointer; typedef unsigned long gsize; typedef long gssize;
+typedef unsigned long size_t; typedef long ssize_t; typedef long time_t; typedef long off_t; typedef long gint64_t;
+typedef int FILE; typedef int va_list; typedef int GString; typedef int GHashTable; typedef int GSList;
+typedef int GList; typedef int GArray; typedef int GPtrArray; typedef int GByteArray; typedef int GTree;
+typedef int GMemChunk; typedef int GIOChannel;
+typedef int tvbuff_t; typedef int packet_info; typedef int proto_tree; typedef int proto_item;
+typedef int emem_strbuf_t; typedef int nstime_t; typedef int address; typedef int conversation_t;
+typedef int fragment_data; typedef int fragment_items; typedef int value_string; typedef int true_false_string;
+typedef int dissector_handle_t; typedef int heur_dissector_list_t; typedef int dissector_table_t;
+typedef int module_t; typedef int hf_register_info; typedef int FILE_T; typedef int wtap; typedef int wtap_dumper;
+typedef int guint8_t; typedef int uint8_t; typedef int uint16_t; typedef int uint32_t; typedef int uint64_t;
+typedef int int8_t; typedef int int16_t; typedef int int32_t; typedef int int64_t;
+#define G_GINT64_MODIFIER "ll"
+#define G_GINT64_FORMAT "lld"
+#define G_GUINT64_FORMAT "llu"
+#define G_GSIZE_FORMAT "lu"
+#define G_DIR_SEPARATOR '/'
+#define G_DIR_SEPARATOR_S "/"
+#define _U_
+#define G_GNUC_UNUSED
+#define G_GNUC_PRINTF(a, b)
+#define G_GNUC_CONST
+#define __attribute__(x)
+#define __inline inline
+#define __inline__ inline
+#define NULL ((void *)0)
+#define TRY if (1)
+#define CATCH(x) else if (0)
+#define CATCH2(x, y) else if (0)
+#define CATCH_ALL else if (0)
+#define FINALLY
+#define ENDTRY
+#define RETHROW
+'''
+
+CPP = ['cpp', '-w', '-undef', '-nostdinc', '-']
+
+ANNOTATION = re.compile(r'\b(BUG|FIX)_([0-9A-F]+)\((\d+)\)')
+LITERAL = re.compile(r'"(?:\\.|[^"\\])*"|\'(?:\\.|[^\'\\])*\'')
+FUNC_HEADER = re.compile(r'([A-Za-z_]\w*)\s*\([^;{}=]*\)[^;{}=()]*$')
+NOT_FUNCTIONS = {'if', 'while', 'for', 'switch', 'return', 'sizeof'}
+PARSE_ERROR = re.compile(r'^(.*?):(\d+):(\d+): before: ')
+LINE_DIRECTIVE = re.compile(r'#(?:\s*line)?\s+(\d+)\s+"([^"]*)"')
+TYPE_BEFORE = re.compile(r'(?:\(\s*([A-Za-z_]\w*)\s*\**\s*\)|([A-Za-z_]\w*))$')
+# 看起来像类型名的标识符: 强制类型转换, 语句或参数开头的声明
+TYPE_USES = [
+    re.compile(r'\(\s*(?:const\s+)?([A-Za-z_]\w*)\s*\*+\s*\)'),
+    re.compile(r'(?:^|[;{}(,])\s*(?:const\s+|static\s+|register\s+)*([A-Za-z_]\w*)\s*\*+\s*[A-Za-z_]\w*(?=\s*(?:_U_\s*)?[;=,)\[])', re.M),
+    re.compile(r'(?:^|[;{}(,])\s*(?:const\s+|static\s+|register\s+)*([A-Za-z_]\w*)\s+[A-Za-z_]\w*(?=\s*(?:_U_\s*)?[;=,)\[])', re.M),
+]
+KEYWORDS = {'auto', 'break', 'case', 'char', 'const', 'continue', 'default', 'do', 'double', 'else', 'enum',
+            'extern', 'float', 'for', 'goto', 'if', 'inline', 'int', 'long', 'register', 'restrict', 'return',
+            'short', 'signed', 'sizeof', 'static', 'struct', 'switch', 'typedef', 'union', 'unsigned', 'void',
+            'volatile', 'while'}
+KNOWN_TYPES = set(re.findall(r'typedef [^;]*?(\w+);', FAKE_HEADER))
+
+
+# 找出文件里所有函数定义的 (名字, 起始行, 结束行), 行号从 0 开始
+def find_functions(lines):
+    stripper = CommentStripper()
+    functions = []
+    depth = 0
+    header, start, current = '', None, None
+    continued = False
+    for i, line in enumerate(lines):
+        code = stripper.strip(line)
+        # 预处理行(包括用 \ 续行的宏定义)不参与括号匹配
+        if continued or code.lstrip().startswith('#'):
+            continued = code.rstrip().endswith('\\')
+            continue
+        code = LITERAL.sub('""', code)
+        for ch in code:
+            if depth == 0:
+                if ch == ';':
+                    header, start = '', None
+                    continue
+                if ch == '{':
+                    m = FUNC_HEADER.search(header)
+                    if m and m.group(1) not in NOT_FUNCTIONS:
+                        current = (m.group(1), start)
+                    depth = 1
+                    continue
+                if start is None and not ch.isspace():
+                    start = i
+                header += ch
+            elif ch == '{':
+                depth += 1
+            elif ch == '}':
+                depth -= 1
+                if depth == 0:
+                    if current is not None:
+                        functions.append((current[0], current[1], i))
+                        current = None
+                        header, start = '', None
+                    else:
+                        # struct / 初始化列表, 后面还有变量名和 ;
+                        header += ' '
+        header += ' '
+    return functions
+
+
+# 收集标注: {id: [(行号, 序号), ...]}
+def find_annotations(lines, kind):
+    sites = {}
+    for i, line in enumerate(lines):
+        for tag, ident, seq in ANNOTATION.findall(line):
+            if tag == kind:
+                sites.setdefault(ident, []).append((i, int(seq)))
+    return sites
+
+
+def file_defines(lines):
+    defines = []
+    continued = False
+    for line in lines:
+        if continued or re.match(r'\s*#\s*define\b', line):
+            defines.append(line)
+            continued = line.rstrip().endswith('\\')
+    return defines
+
+
+def preprocess(text):
+    result = subprocess.run(CPP, input=text, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(result.stderr.strip())
+    return result.stdout
+
+
+# 解析一个函数; 先按用法猜出没有声明的类型名, 还有不认识的类型名报错时再补一个 typedef 重试
+def parse_function(filename, lines, defines, start, end):
+    body = '\n'.join(lines[start:end + 1])
+    text = preprocess(FAKE_HEADER + '\n'.join(defines) + '\n#line %d "%s"\n' % (start + 1, filename) + body + '\n')
+    typedefs = guess_types(body)
+    for _ in range(64):
+        source = ''.join('typedef int %s;\n' % name for name in typedefs) + text
+        try:
+            ast = c_parser.CParser().parse(source, filename)
+        except c_parser.ParseError as e:
+            name = unknown_type(source, str(e))
+            if name is None or name in typedefs:
+                raise
+            typedefs.append(name)
+            continue
+        funcs = [node for node in ast.ext if isinstance(node, c_ast.FuncDef)]
+        if not funcs:
+            raise ValueError('no function definition found')
+        return funcs[-1], typedefs
+    raise ValueError('too many unknown types')
+
+
+# 类型都当成 int, 只要能解析出语法结构就可以
+def guess_types(text):
+    names = []
+    for pattern in TYPE_USES:
+        for name in pattern.findall(text):
+            if name not in KEYWORDS and name not in KNOWN_TYPES and name not in names:
+                names.append(name)
+    return names
+
+
+# 报错位置前面的标识符通常就是没有声明的类型名, 比如 "tvbuff_t *tvb" 报在 * 上,
+# "(foo_t)x" 报在 x 上
+def unknown_type(source, message):
+    m = PARSE_ERROR.search(message)
+    if m is None:
+        return None
+    filename, line, column = m.group(1), int(m.group(2)), int(m.group(3))
+    # 错误位置是 #line 映射以后的行号, 在预处理结果里找到对应的那一行
+    target = None
+    current, current_file = None, None
+    for raw in source.split('\n'):
+        directive = LINE_DIRECTIVE.match(raw)
+        if directive:
+            current, current_file = int(directive.group(1)), directive.group(2)
+            continue
+        if current == line and current_file == filename:
+            target = raw
+        if current is not None:
+            current += 1
+    if target is None:
+        return None
+    before = TYPE_BEFORE.search(target[:column - 1].rstrip())
+    if before is None:
+        return None
+    return before.group(1) or before.group(2)
+
+
+# 紧凑格式: {"_": 类型, 属性..., 子节点...}, 省略空值, 坐标只保留原文件行号
+# 属性里的空列表(quals 等)省略, 还原时补回 []; 子节点列表即使为空也保留, 和 None 区分开
+LIST_ATTRS = {'quals', 'align', 'storage', 'funcspec', 'names', 'dim_quals'}
+SKIP_SLOTS = {'coord', '__weakref__'}
+
+
+def to_compact(node):
+    result = {'_': node.__class__.__name__}
+    for name in node.__slots__:
+        if name in SKIP_SLOTS:
+            continue
+        value = getattr(node, name)
+        if name in node.attr_names:
+            if value is not None and value != []:
+                result[name] = value
+        elif isinstance(value, list):
+            result[name] = [to_compact(child) for child in value]
+        elif value is not None:
+            result[name] = to_compact(value)
+    if node.coord is not None and node.coord.line:
+        result['l'] = node.coord.line
+    return result
+
+
+def from_compact(data):
+    """把紧凑格式还原成 pycparser 的 c_ast 节点(不含坐标)"""
+    klass = getattr(c_ast, data['_'])
+    kwargs = {}
+    for name in klass.__slots__:
+        if name in SKIP_SLOTS:
+            continue
+        value = data.get(name)
+        if name in klass.attr_names:
+            if value is None and name in LIST_ATTRS:
+                value = []
+        elif isinstance(value, dict):
+            value = from_compact(value)
+        elif isinstance(value, list):
+            value = [from_compact(child) for child in value]
+        kwargs[name] = value
+    return klass(**kwargs)
+
+
+def extract_side(filename, lines, defines, span):
+    _, start, end = span
+    side = {'start': start + 1, 'end': end + 1}
+    try:
+        func, typedefs = parse_function(filename, lines, defines, start, end)
+        side['ast'] = to_compact(func)
+        if typedefs:
+            side['typedefs'] = typedefs
+    except Exception as e:
+        side['error'] = str(e).split('\n')[0]
+    return side
+
+
+# 标注所在的函数 (name, start, end), 不在任何函数里返回 None
+def enclosing(functions, line):
+    for function in functions:
+        if function[1] <= line <= function[2]:
+            return function
+    return None
+
+
+# 另一边按函数名找对应的函数; 同名的定义可能有几个(#ifdef 的不同分支), 取位置最近的
+def closest(functions, span):
+    name, start, _ = span
+    matches = [f for f in functions if f[0] == name]
+    if not matches:
+        return None
+    return min(matches, key=lambda f: abs(f[1] - start))
+
+
+def extract_pair(pair):
+    source_path, target_path = pair
+    filename = os.path.basename(source_path)
+    side_lines = {}
+    for kind, path in (('BUG', source_path), ('FIX', target_path)):
+        with open(path, encoding='utf-8', errors='replace') as f:
+            side_lines[kind] = f.read().split('\n')
+
+    records = []
+    sides = {}
+    for kind, lines in side_lines.items():
+        sides[kind] = (lines, file_defines(lines), find_functions(lines), find_annotations(lines, kind))
+
+    ids = sorted(set(sides['BUG'][3]) | set(sides['FIX'][3]))
+    for ident in ids:
+        # 同一个标注可能跨越多个函数, 每对 (buggy 函数, fixed 函数) 一条记录;
+        # 标注所在的一边用它实际所在的函数, 另一边取同名且位置最近的函数
+        spans = {}
+        for kind, other in (('BUG', 'FIX'), ('FIX', 'BUG')):
+            _, _, functions, annotations = sides[kind]
+            for line, seq in annotations.get(ident, []):
+                span = enclosing(functions, line)
+                partner = closest(sides[other][2], span) if span else None
+                key = (span, partner) if kind == 'BUG' else (partner, span)
+                spans.setdefault(key, {'BUG': [], 'FIX': []})[kind].append([line + 1, seq])
+
+        def order(key):
+            span = key[0] or key[1]
+            return (span is None, span[0] if span else '',
+                    key[0][1] if key[0] else -1, key[1][1] if key[1] else -1)
+
+        for key in sorted(spans, key=order):
+            name = (key[0] or key[1] or (None,))[0]
+            record = {'v': FORMAT_VERSION, 'id': ident, 'file': filename, 'function': name}
+            for span, kind, out in ((key[0], 'BUG', 'buggy'), (key[1], 'FIX', 'fixed')):
+                lines, defines, _, _ = sides[kind]
+                side = extract_side(filename, lines, defines, span) if span else {}
+                side['sites'] = spans[key][kind]
+                record[out] = side
+            records.append(record)
+    return filename, records
+
+
+def extractor_hash():
+    h = hashlib.sha256(inspect.getsource(sys.modules[__name__]).encode('utf-8'))
+    h.update(inspect.getsource(sys.modules[CommentStripper.__module__]).encode('utf-8'))
+    h.update(pycparser.__version__.encode('utf-8'))
+    return h.hexdigest()
+
+
+def pair_hash(pair, code):
+    h = hashlib.sha256(code.encode('utf-8'))
+    for path in pair:
+        with open(path, 'rb') as f:
+            h.update(hashlib.sha256(f.read()).digest())
+    return h.hexdigest()
+
+
+def cached_extract(task):
+    pair, cache_path = task
+    if os.path.exists(cache_path):
+        with gzip.open(cache_path, 'rt', encoding='utf-8') as f:
+            return json.load(f), True
+    filename, records = extract_pair(pair)
+    tmp_path = cache_path + '.%d.tmp' % os.getpid()
+    with gzip.open(tmp_path, 'wt', encoding='utf-8') as f:
+        json.dump(records, f, separators=(',', ':'))
+    os.replace(tmp_path, cache_path)
+    return records, False
+
+
+def run(sources='sources_edited', targets='targets_edited', dst='ast_pairs.jsonl.gz', cache_dir='.ast_cache',
+        workers=None):
+    start = time.perf_counter()
+    os.makedirs(cache_dir, exist_ok=True)
+    code = extractor_hash()
+    tasks = []
+    for source_path in sorted(glob.glob(os.path.join(sources, '*.c'))):
+        target_path = os.path.join(targets, os.path.basename(source_path))
+        if not os.path.exists(target_path):
+            print("no fixed version for " + source_path)
+            continue
+        pair = (source_path, target_path)
+        tasks.append((pair, os.path.join(cache_dir, pair_hash(pair, code) + '.json.gz')))
+
+    records, cached, failed = 0, 0, 0
+    with Pool(workers) as pool, gzip.open(dst, 'wt', encoding='utf-8') as out:
+        # 文件之间互不依赖, 并行解析; imap 保证输出顺序固定
+        for file_records, hit in pool.imap(cached_extract, tasks):
+            cached += hit
+            for record in file_records:
+                records += 1
+                failed += any('error' in record[key] for key in ('buggy', 'fixed'))
+                out.write(json.dumps(record, separators=(',', ':')) + '\n')
+
+    seconds = time.perf_counter() - start
+    print("files: %d (cached %d)  records: %d  with parse errors: %d  time (s): %.2f"
+          % (len(tasks), cached, records, failed, seconds))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--sources', default='sources_edited')
+    parser.add_argument('--targets', default='targets_edited')
+    parser.add_argument('--dst', default='ast_pairs.jsonl.gz')
+    parser.add_argument('--cache', default='.ast_cache')
+    parser.add_argument('--workers', type=int, default=None)
+    args = parser.parse_args()
+    run(args.sources, args.targets, args.dst, args.cache, args.workers)
@@ -0,0 +1,181 @@
+import argparse
+import hashlib
+import inspect
+import json
+import math
+import sqlite3
+import time
+from collections import Counter
+from multiprocessing import Pool
+
+import pandas as pd
+
+import comment_remover
+import preprocess_data_1
+import preprocess_data_2
+import preprocess_data_3
+import preprocess_data_4
+
+# 增量运行四个预处理步骤: 每条记录的每一步输出按 (步骤代码hash, 记录内容hash) 缓存,
+# 只有内容变了的记录或者代码变了的步骤才会重新计算, 最后写出和 preprocess_data_4 相同的 jsonl
+# 每一步对一条记录返回 (输出的记录列表, 删除原因), 没有删除时原因是 None
+
+
+# NaN 转成 None, 才能 json 序列化和计算 hash
+def value(v):
+    return None if isinstance(v, float) and math.isnan(v) else v
+
+
+# 第一步: 对这一条记录调用 preprocess_data_1.split_files_changed,
+# 再像 preprocess_data_2.read_input 那样只取 cve_id/files_changed/summary 三列
+# (拆出来的片段在 0/1/2 列里, 这三列是空的, 第二步会当作 empty 删除)
+def stage_split(record):
+    cve_id, summary, files_changed = record
+    df = pd.DataFrame({'cve_id': [cve_id], 'summary': [summary], 'files_changed': [files_changed]})
+    first, appended = preprocess_data_1.split_files_changed(df)
+    return [(value(c), value(f), value(s))
+            for rows in (first, appended)
+            for c, f, s in zip(rows['cve_id'], rows['files_changed'], rows['summary'])], None
+
+
+def stage_filter(record):
+    cve_id, files_changed, summary = record
+    patch, reason = preprocess_data_2.extract_patch(files_changed)
+    if reason is not None:
+        return [], reason
+    return [(cve_id, patch, summary)], None
+
+
+def stage_clean(record):
+    cve_id, patch, summary = record
+    return [(cve_id, preprocess_data_3.clean_patch(patch), summary)], None
+
+
+# 第四步的 row 和 hunk_index 依赖记录在整个输出里的位置, 最后统一编号, 这里只缓存 hunk 内容
+def stage_hunks(record):
+    cve_id, patch, summary = record
+    if not patch:
+        return [(cve_id, [])], None
+    return [(cve_id, preprocess_data_4.split_hunks(patch))], None
+
+
+# 没装 demjson 时第二步删掉的行和装了以后不同, 要算进这一步的 hash
+def demjson_version():
+    if preprocess_data_2.demjson is None:
+        return 'demjson missing'
+    return 'demjson ' + str(getattr(preprocess_data_2.demjson, '__version__', 'installed'))
+
+
+# (名字, 函数, 计算 hash 的代码和环境, 打印删除原因的函数)
+STAGES = [
+    ('split', stage_split, [preprocess_data_1, value], None),
+    ('filter', stage_filter, [preprocess_data_2, demjson_version()], preprocess_data_2.print_reasons),
+    ('clean', stage_clean, [preprocess_data_3, comment_remover], None),
+    ('hunks', stage_hunks, [preprocess_data_4], None),
+]
+
+
+def code_hash(fn, sources):
+    h = hashlib.sha256(inspect.getsource(fn).encode('utf-8'))
+    for source in sources:
+        if not isinstance(source, str):
+            source = inspect.getsource(source)
+        h.update(source.encode('utf-8'))
+    return h.hexdigest()
+
+
+def record_hash(record):
+    return hashlib.sha256(json.dumps(record, ensure_ascii=False).encode('utf-8')).hexdigest()
+
+
+class Cache:
+    def __init__(self, path):
+        self.db = sqlite3.connect(path)
+        self.db.execute('CREATE TABLE IF NOT EXISTS outputs ('
+                        'stage TEXT, code TEXT, record TEXT, output TEXT, '
+                        'PRIMARY KEY (stage, code, record))')
+
+    def get(self, stage, code, keys):
+        found = {}
+        keys = list(set(keys))
+        for i in range(0, len(keys), 500):
+            part = keys[i:i + 500]
+            rows = self.db.execute('SELECT record, output FROM outputs WHERE stage = ? AND code = ? AND record IN (%s)'
+                                   % ','.join('?' * len(part)), [stage, code] + part)
+            for key, output in rows:
+                found[key] = json.loads(output)
+        return found
+
+    def put(self, stage, code, items):
+        self.db.executemany('INSERT OR REPLACE INTO outputs VALUES (?, ?, ?, ?)',
+                            [(stage, code, key, json.dumps(output, ensure_ascii=False)) for key, output in items])
+        self.db.commit()
+
+
+def run_stage(pool, cache, name, fn, sources, records, chunksize):
+    start = time.perf_counter()
+    code = code_hash(fn, sources)
+    keys = [record_hash(record) for record in records]
+    outputs = cache.get(name, code, keys)
+
+    missing = {}
+    for key, record in zip(keys, records):
+        if key not in outputs:
+            missing[key] = record
+    # 没有命中缓存的记录分块并行计算
+    computed = pool.map(fn, list(missing.values()), chunksize=chunksize)
+    # 经过 json 的结果和从缓存读出来的一致(元组变成列表)
+    computed = [json.loads(json.dumps(output, ensure_ascii=False)) for output in computed]
+    cache.put(name, code, zip(missing.keys(), computed))
+    outputs.update(zip(missing.keys(), computed))
+
+    results = [item for key in keys for item in outputs[key][0]]
+    reasons = Counter(outputs[key][1] for key in keys if outputs[key][1] is not None)
+    seconds = time.perf_counter() - start
+    print("%-7s in %7d  cached %7d  computed %7d  out %7d  %7.2fs  %9.0f rec/s"
+          % (name, len(records), len(records) - len(missing), len(missing), len(results),
+             seconds, len(records) / max(seconds, 1e-9)))
+    return results, reasons
+
+
+def load_input(src):
+    df = preprocess_data_1.read_input(src)
+    return [[value(c), value(s), value(f)]
+            for c, s, f in zip(df['cve_id'], df['summary'], df['files_changed'])]
+
+
+def run(src='vul_data.csv', dst='vul_pairs.jsonl', cache_path='.pipeline_cache.sqlite', workers=None, chunksize=64):
+    cache = Cache(cache_path)
+    records = load_input(src)
+    with Pool(workers) as pool:
+        for name, fn, sources, report in STAGES:
+            records, reasons = run_stage(pool, cache, name, fn, sources, records, chunksize)
+            if report is not None:
+                report(reasons)
+
+    # 和 preprocess_data_4 一样: row 是第三步输出的行号, hunk_index 在同一个 cve 内连续编号
+    hunk_counter = Counter()
+    written = 0
+    with open(dst, 'w', encoding='utf8') as out:
+        for row, (cve_id, hunks) in enumerate(records):
+            # 经过 csv 的空 cve_id 读出来是空字符串
+            cve_id = '' if cve_id is None else cve_id
+            for buggy, repaired in hunks:
+                record = {'cve_id': cve_id, 'hunk_index': hunk_counter[cve_id], 'row': row,
+                          'buggy': buggy, 'repaired': repaired}
+                hunk_counter[cve_id] += 1
+                out.write(json.dumps(record, ensure_ascii=False) + '\n')
+                written += 1
+    print("hunks written: " + str(written))
+    return written
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--src', default='vul_data.csv')
+    parser.add_argument('--dst', default='vul_pairs.jsonl')
+    parser.add_argument('--cache', default='.pipeline_cache.sqlite')
+    parser.add_argument('--workers', type=int, default=None)
+    parser.add_argument('--chunksize', type=int, default=64)
+    args = parser.parse_args()
+    run(args.src, args.dst, args.cache, args.workers, args.chunksize)
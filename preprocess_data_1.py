@@ -1,47 +1,108 @@
+import argparse
+import os
+import shutil
+import tempfile
+import time
+
+import numpy as np
 import pandas as pd
 
-def preprocess_data():
-    # 读入数据
-    df = pd.read_csv('vul_data.csv', header=None, skiprows=1)
-    df.columns = ["number", "authentication_required", "availability_impact", "cve_id", "cve_page", "cwe_id",
-                  "access_complexity",
-                  "confidentiality_impact", "integrity_impact", "publish_date", "score", "summary", "update_date",
-                  "vulnerability_classification", "ref_link", "commit_id", "commit_message", "files_changed", "lang",
-                  "project",
-                  "version_after_fix", "version_before_fix"]
+COLUMNS = ["number", "authentication_required", "availability_impact", "cve_id", "cve_page", "cwe_id",
+           "access_complexity",
+           "confidentiality_impact", "integrity_impact", "publish_date", "score", "summary", "update_date",
+           "vulnerability_classification", "ref_link", "commit_id", "commit_message", "files_changed", "lang",
+           "project",
+           "version_after_fix", "version_before_fix"]
+
+# 原来逐行 df.append 生成的 vul_data_1.csv 的列顺序, 第二步按位置读取, 不能改
+OUTPUT_COLUMNS = [0, 1, 2, 'cve_id', 'files_changed', 'summary']
+
+SEPARATOR = "<_**next**_>"
+
+
+# 数据中有这样的 <_**next**_> 的信息全部分割
+# 第一段留在原来的行, 其余每段放到 0/1/2 列(cve_id, 片段, summary)的新行里, 这些行的 index 都是 0
+def split_files_changed(df):
     df = df[['cve_id', 'summary', 'files_changed']]
-    #file_after = []
-    #file_before = []
-
-    # 数据中有这样的 <_**next**_> 的信息全部分割
-    for index, item in enumerate(df['files_changed']):
-        content_str = "<_**next**_>"
-        originalstr = item
-        position = 0
-        t = 1
-        if type(originalstr) != str:
-            df = df.drop(index=[index])
-            continue
-        p = originalstr.find(content_str, position)
-        pre = p
-        while t != -1 and p != -1:
-            p = originalstr.find(content_str, position)
-            position = p + len(content_str)
-            t = originalstr.find(content_str, position)
-            if t == -1:
-                curStr = originalstr[position:]
-            else:
-                curStr = originalstr[position:t]
-            df2 = pd.DataFrame([[df.loc[index, 'cve_id'], curStr, df.loc[index, 'summary']]])
-            df = df.append(df2)
-
-
-        if pre != -1:
-            item = item[0:pre]
-            df.loc[index, 'files_changed'] = item
-
-    df.to_csv("vul_data_1.csv")
+    df = df[df['files_changed'].map(lambda x: isinstance(x, str))]
+    # 分块读取时某一块可能全是空值, 这一列会被推断成 float, 没有 .str
+    pieces = df['files_changed'].astype(object).str.split(SEPARATOR, regex=False)
+
+    first = pd.DataFrame({0: np.nan, 1: np.nan, 2: np.nan,
+                          'cve_id': df['cve_id'],
+                          'files_changed': pieces.str[0],
+                          'summary': df['summary']},
+                         index=df.index, columns=OUTPUT_COLUMNS)
+
+    rest = pieces.str[1:]
+    rest = rest[rest.str.len() > 0].explode()
+    appended = pd.DataFrame({0: df['cve_id'].reindex(rest.index),
+                             1: rest,
+                             2: df['summary'].reindex(rest.index),
+                             'cve_id': np.nan, 'files_changed': np.nan, 'summary': np.nan},
+                            columns=OUTPUT_COLUMNS)
+    appended.index = np.zeros(len(appended), dtype=np.int64)
+    return first, appended
+
+
+def read_input(path, chunksize=None):
+    return pd.read_csv(path, header=None, skiprows=1, names=COLUMNS, chunksize=chunksize)
+
+
+def preprocess_data(src='vul_data.csv', dst='vul_data_1.csv', chunksize=None):
+    if chunksize is None:
+        first, appended = split_files_changed(read_input(src))
+        pd.concat([first, appended]).to_csv(dst)
+        return len(first) + len(appended)
+
+    # 分块模式: 原始行直接写出, 拆出来的行先放到临时文件, 最后接在后面, 顺序和一次性处理相同
+    rows = 0
+    with tempfile.NamedTemporaryFile('w+', suffix='.csv', dir=os.path.dirname(os.path.abspath(dst)),
+                                     encoding='utf-8', newline='') as spool:
+        with open(dst, 'w', encoding='utf-8', newline='') as out:
+            header = True
+            for chunk in read_input(src, chunksize):
+                first, appended = split_files_changed(chunk)
+                first.to_csv(out, header=header)
+                appended.to_csv(spool, header=False)
+                header = False
+                rows += len(first) + len(appended)
+            if header:
+                pd.DataFrame(columns=OUTPUT_COLUMNS).to_csv(out)
+            spool.seek(0)
+            shutil.copyfileobj(spool, out)
+    return rows
+
+
+# 计时: 把 src 处理 repeat 次(输出到临时文件), 返回每次的秒数和行数
+def benchmark(src='vul_data.csv', chunksize=None, repeat=3):
+    timings = []
+    rows = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        dst = os.path.join(tmp, 'vul_data_1.csv')
+        for _ in range(repeat):
+            start = time.perf_counter()
+            rows = preprocess_data(src, dst, chunksize)
+            timings.append(time.perf_counter() - start)
+    best = min(timings)
+    print("rows: %d  best of %d: %.3fs  %.0f rows/s" % (rows, repeat, best, rows / max(best, 1e-9)))
+    return timings, rows
 
 
 if __name__ == '__main__':
-    preprocess_data()
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--src', default='vul_data.csv')
+    parser.add_argument('--dst', default='vul_data_1.csv')
+    parser.add_argument('--chunksize', type=int, default=None, help='rows per chunk, for inputs larger than memory')
+    parser.add_argument('--benchmark', type=int, default=0, metavar='REPEAT',
+                        help='only time REPEAT runs on --src, without writing --dst')
+    args = parser.parse_args()
+
+    if args.benchmark:
+        benchmark(args.src, args.chunksize, args.benchmark)
+    else:
+        start = time.perf_counter()
+        rows = preprocess_data(args.src, args.dst, args.chunksize)
+        seconds = time.perf_counter() - start
+        print("rows written: " + str(rows))
+        print("time (s): %.2f, %.0f rows/s" % (seconds, rows / max(seconds, 1e-9)))
@@ -1,32 +1,103 @@
+import argparse
+import json
+from collections import Counter
+from multiprocessing import Pool
+
 import pandas as pd
-import demjson
 
-def preprocess_data():
+# demjson 只用来解析不规范的 json, 没装的时候这些行单独计数删除
+try:
+    import demjson
+except ImportError:
+    demjson = None
+
+EXTENSIONS = ('.cpp', '.c', '.h', '.cc', '.cxx', '.hpp', '.c++', '.C')
+
+
+class NeedsDemjson(ValueError):
+    pass
+
+
+# 先用严格的 json 解析, 只有失败的行才交给慢的 demjson
+def decode_json(item):
+    try:
+        return json.loads(item)
+    except ValueError:
+        if demjson is None:
+            raise NeedsDemjson(item[:80])
+        return demjson.decode(item, "utf-8")
+
+
+# 对于files_changes的内容json分析, 返回 (patch, None) 或者 (None, 删除原因)
+def extract_patch(item):
+    if type(item) != str:
+        return None, 'empty'
+    try:
+        code = decode_json(item)
+    except NeedsDemjson:
+        return None, 'needs_demjson'
+    except Exception:
+        return None, 'invalid_json'
+    if not isinstance(code, dict) or not isinstance(code.get('filename'), str):
+        return None, 'no_filename'
+    # 删除文件名不是 .c .cpp .h三个中的一个的
+    if not code['filename'].endswith(EXTENSIONS):
+        return None, 'extension'
+    if 'patch' not in code:
+        return None, 'no_patch'
+    return code['patch'], None
+
 
-    df = pd.read_csv('vul_data_1.csv', header=None, skiprows=1)
-    df.columns = ['number', '1', '2', '3', 'cve_id', 'files_changed', 'summary']
+def filter_rows(df):
     df = df[['cve_id', 'files_changed', 'summary']]
-    print(df.head(10))
-    # 对于files_changes的内容json分析
-    for index, item in enumerate(df['files_changed']):
-        if type(item) != str:
-            df = df.drop(index=[index])
-            continue
-        code = demjson.decode(item, "utf-8")
-        name = code['filename']
-
-        # 删除文件名不是 .c .cpp .h三个中的一个的
-        if name.endswith(('.cpp', '.c', '.h', '.cc', '.cxx', '.hpp', '.c++','.C')) and ('patch' in code.keys()):
-            item = code['patch']
-            df.loc[index, 'files_changed'] = item
-        else:
-            df = df.drop(index=[index])
-
-        # print(line)
-        # 对于需要增加的部分直接放入 file_after(code['filename'])
-    df.to_csv("vul_data_2.csv")
-    # 对于这样的部分直接删除 \\n-\\t 直到下一个 \\n 放入file_before
+    results = [extract_patch(item) for item in df['files_changed']]
+    reasons = Counter(reason for _, reason in results if reason is not None)
+
+    keep = pd.Series([reason is None for _, reason in results], index=df.index)
+    df = df[keep].copy()
+    df['files_changed'] = [patch for patch, reason in results if reason is None]
+    return df.rename(columns={'files_changed': 'patch'}), reasons
+
+
+def read_input(path, chunksize=None):
+    return pd.read_csv(path, header=None, skiprows=1,
+                       names=['number', '1', '2', '3', 'cve_id', 'files_changed', 'summary'],
+                       chunksize=chunksize)
+
+
+def preprocess_data(src='vul_data_1.csv', dst='vul_data_2.csv', chunksize=None, workers=None):
+    reasons = Counter()
+    if chunksize is None:
+        df, reasons = filter_rows(read_input(src))
+        df.to_csv(dst)
+    else:
+        # 分块并行处理, imap 保证输出顺序和输入一致
+        with Pool(workers) as pool, open(dst, 'w', encoding='utf-8', newline='') as out:
+            header = True
+            for df, chunk_reasons in pool.imap(filter_rows, read_input(src, chunksize)):
+                df.to_csv(out, header=header)
+                header = False
+                reasons.update(chunk_reasons)
+            if header:
+                pd.DataFrame(columns=['cve_id', 'patch', 'summary']).to_csv(out)
+
+    print_reasons(reasons)
+    return reasons
+
+
+def print_reasons(reasons):
+    print("rows dropped:")
+    for reason in ('empty', 'invalid_json', 'needs_demjson', 'no_filename', 'extension', 'no_patch'):
+        print("  %-13s %d" % (reason, reasons[reason]))
+    if reasons['needs_demjson']:
+        print("  (install demjson to keep the needs_demjson rows)")
 
 
 if __name__ == '__main__':
-    preprocess_data()
\ No newline at end of file
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--src', default='vul_data_1.csv')
+    parser.add_argument('--dst', default='vul_data_2.csv')
+    parser.add_argument('--chunksize', type=int, default=None, help='rows per chunk, processed in parallel')
+    parser.add_argument('--workers', type=int, default=None)
+    args = parser.parse_args()
+    preprocess_data(args.src, args.dst, args.chunksize, args.workers)
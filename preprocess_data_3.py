@@ -1,27 +1,38 @@
-import pandas as pd
+import argparse
 import re
-import os
+from multiprocessing import Pool
+
+import pandas as pd
+
+from comment_remover import remove_comments
 
-# revised for original one miss some of the comments
 
-def preprocess_data():
-    df = pd.read_csv('vul_data_2.csv', header=None, skiprows=1)
+# 同时处理 各种不同样式的注释, 然后去掉 @@ ... @@ 里的行号信息
+# 行首保留 @@, 第四步靠它切分 hunk
+def clean_patch(item):
+    if type(item) != str:
+        return item
+    item = remove_comments(item)
+    return re.sub(r'^@@[^@\n]*@@', "@@", item, flags=re.M)
+
+
+def preprocess_data(src='vul_data_2.csv', dst='vul_data_3.csv', workers=None):
+    df = pd.read_csv(src, header=None, skiprows=1)
     print(df.head(5))
     df.columns = ['number', 'cve_id', 'patch', 'summary']
 
-    for index, item in enumerate(df['patch']):
-        with open('/content/temp.c','w') as f:
-          f.write(item)
-        os.system("sh /content/remover.sh")
-        with open('/content/tempRemoved.c','r') as f2:
-          item = f2.read()
-        print(item)
-        item = re.sub(r'@@.*@@', " ", item)
-        df.loc[index, 'patch'] = item
-    # 同时处理 各种不同样式的注释
+    # 每行互不依赖, 直接在进程池里处理, 不再经过临时文件和 shell
+    with Pool(workers) as pool:
+        df['patch'] = pool.map(clean_patch, df['patch'], chunksize=64)
+
     df = df[['cve_id', 'patch', 'summary']]
-    df.to_csv("vul_data_3.csv")
+    df.to_csv(dst)
 
 
 if __name__ == '__main__':
-    preprocess_data()
\ No newline at end of file
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--src', default='vul_data_2.csv')
+    parser.add_argument('--dst', default='vul_data_3.csv')
+    parser.add_argument('--workers', type=int, default=None)
+    args = parser.parse_args()
+    preprocess_data(args.src, args.dst, args.workers)
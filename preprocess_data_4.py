@@ -1,27 +1,82 @@
-import pandas as pd
+import argparse
+import csv
+import json
+from collections import Counter
+from multiprocessing import Pool
 
 
-def preprocess_data():
-    # File: readline-example-5.py
-    source = open("vul_buggy.csv", "w", encoding="utf8")
-    target = open("vul_repaired.csv", "w", encoding="utf8")
-    file = open("vul_data_3.csv", encoding="utf8")
-    for line in file:
-        if line[0] == '-':
-            source.write(line[1:])
-        elif line[0] == '+':
-            target.write(line[1:])
-        elif len(line) != 0 and len(line)!= 1 and line != " "and line[0] != "#" and line[0:1] != " #":
-            source.write(line)
-            target.write(line)
+# 把一个 patch 按 @@ 切成 hunk, 每个 hunk 给出 (buggy, repaired)
+# '-' 行只进 buggy, '+' 行只进 repaired, 上下文两边都有
+# 和原来逐行写 vul_buggy.csv / vul_repaired.csv 的版本一样: 上下文行整行保留(包括开头的空格),
+# 只去掉完全空的行和没有前缀直接以 # 开头的行; ' #include' 这样的上下文行和空白的上下文行都保留
+def split_hunks(patch):
+    hunks = []
+    buggy, repaired = None, None
+    for line in patch.split('\n'):
+        if line.startswith('@@'):
+            buggy, repaired = [], []
+            hunks.append((buggy, repaired))
+            # @@ 后面的函数名也是上下文
+            line = line[2:]
+            if not line.strip():
+                continue
+        elif buggy is None:
+            buggy, repaired = [], []
+            hunks.append((buggy, repaired))
 
+        if line.startswith('-'):
+            buggy.append(line[1:])
+        elif line.startswith('+'):
+            repaired.append(line[1:])
+        elif line.startswith('\\'):
+            # "\ No newline at end of file" 不是代码; 原来的版本把它当上下文写进两边, 这里有意不要
+            continue
+        else:
+            if not line or line.startswith('#'):
+                continue
+            buggy.append(line)
+            repaired.append(line)
+    return [('\n'.join(b), '\n'.join(r)) for b, r in hunks]
 
-    # df = pd.read_csv('vul_data_3.csv', header=None, skiprows=1)
-    # df.columns = ['number', 'cve_id', 'patch', 'summary']
-    #
-    #
-    # df.to_csv("vul_data_4")
+
+def extract_row(row):
+    number, cve_id, patch = row[0], row[1], row[2]
+    if not patch:
+        return number, cve_id, []
+    return number, cve_id, split_hunks(patch)
+
+
+def read_rows(path):
+    # 有的 patch 超过 csv 模块默认的 128KB 字段上限
+    csv.field_size_limit(2 ** 31 - 1)
+    with open(path, encoding='utf8', newline='') as f:
+        reader = csv.reader(f)
+        next(reader)  # 表头: ,cve_id,patch,summary
+        for row in reader:
+            yield row
+
+
+def preprocess_data(src='vul_data_3.csv', dst='vul_pairs.jsonl', workers=None):
+    # 同一个 cve 可能有多个文件(多行), hunk_index 按输入顺序在同一个 cve 内连续编号
+    hunk_counter = Counter()
+    records = 0
+    with Pool(workers) as pool, open(dst, 'w', encoding='utf8') as out:
+        # imap 按输入顺序返回结果, 输出顺序是确定的
+        for number, cve_id, hunks in pool.imap(extract_row, read_rows(src), chunksize=64):
+            for buggy, repaired in hunks:
+                record = {'cve_id': cve_id, 'hunk_index': hunk_counter[cve_id], 'row': int(number),
+                          'buggy': buggy, 'repaired': repaired}
+                hunk_counter[cve_id] += 1
+                out.write(json.dumps(record, ensure_ascii=False) + '\n')
+                records += 1
+    print("hunks written: " + str(records))
+    return records
 
 
 if __name__ == '__main__':
-    preprocess_data()
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--src', default='vul_data_3.csv')
+    parser.add_argument('--dst', default='vul_pairs.jsonl')
+    parser.add_argument('--workers', type=int, default=None)
+    args = parser.parse_args()
+    preprocess_data(args.src, args.dst, args.workers)
@@ -0,0 +1,83 @@
+import unittest
+
+from comment_remover import CommentStripper, remove_comments
+
+
+def strip_lines(*lines):
+    stripper = CommentStripper()
+    return [stripper.strip(line) for line in lines]
+
+
+class CommentStripperTest(unittest.TestCase):
+    def test_line_comment(self):
+        self.assertEqual(strip_lines('int a; // note'), ['int a; '])
+        self.assertEqual(strip_lines('// whole line'), [''])
+
+    def test_block_comment(self):
+        self.assertEqual(strip_lines('a = 1; /* x */ b = 2;'), ['a = 1;  b = 2;'])
+        self.assertEqual(strip_lines('/** doc */'), [''])
+
+    def test_block_comment_keeps_tokens_apart(self):
+        self.assertEqual(strip_lines('int/**/x;'), ['int x;'])
+        self.assertEqual(strip_lines('a+/**/b'), ['a+b'])
+
+    def test_block_comment_spans_lines(self):
+        self.assertEqual(strip_lines('f(); /* start', 'still comment', 'end */ g();'),
+                         ['f(); ', '', ' g();'])
+
+    def test_markers_inside_strings(self):
+        self.assertEqual(strip_lines('s = "/* not */ // a comment"; // real'),
+                         ['s = "/* not */ // a comment"; '])
+        self.assertEqual(strip_lines(r's = "say \"//\""; /* c */'), [r's = "say \"//\""; '])
+        self.assertEqual(strip_lines("c = '/'; d = '*'; /* c */"), ["c = '/'; d = '*'; "])
+
+    def test_comment_markers_inside_comments(self):
+        self.assertEqual(strip_lines('/* "quoted // */ x;'), [' x;'])
+        self.assertEqual(strip_lines('x; // /* not a block', 'y;'), ['x; ', 'y;'])
+
+
+class RemoveCommentsTest(unittest.TestCase):
+    def test_plain_diff(self):
+        patch = '@@ -1,3 +1,3 @@ int f()\n a(); // ctx\n-b(); /* old */\n+c(); /* new */'
+        self.assertEqual(remove_comments(patch), '@@ -1,3 +1,3 @@ int f()\n a(); \n-b(); \n+c(); ')
+
+    def test_block_comment_across_context(self):
+        patch = '@@ -1,3 +1,3 @@\n /* a\n b\n c */ x();'
+        self.assertEqual(remove_comments(patch), '@@ -1,3 +1,3 @@\n \n \n  x();')
+
+    def test_block_comment_on_one_side(self):
+        # '+' 行打开的注释只影响新代码, '-' 行还是代码
+        patch = '@@ -1,2 +1,3 @@\n+/* disabled\n-old();\n+ new(); */\n+kept();'
+        self.assertEqual(remove_comments(patch), '@@ -1,2 +1,3 @@\n+\n-old();\n+\n+kept();')
+
+    def test_divergent_context_is_split(self):
+        # '-' 行打开的块注释在上下文行里才结束, 两边对这一行的看法不同
+        patch = '@@ -1 +1 @@\n-/* start\n+foo();\n ctx */ bar();'
+        self.assertEqual(remove_comments(patch),
+                         '@@ -1 +1 @@\n-\n+foo();\n- bar();\n+ctx */ bar();')
+
+    def test_divergent_context_converges(self):
+        # 注释结束以后两边又一致, 后面的上下文行不再拆分
+        patch = '@@ -1 +1 @@\n-x(); /* a\n+x();\n b */\n y();'
+        self.assertEqual(remove_comments(patch), '@@ -1 +1 @@\n-x(); \n+x();\n-\n+b */\n y();')
+
+    def test_hunk_header_resets_state(self):
+        patch = '@@ -1 +1 @@\n /* open\n@@ -9 +9 @@\n code();'
+        self.assertEqual(remove_comments(patch), '@@ -1 +1 @@\n \n@@ -9 +9 @@\n code();')
+
+    def test_hunk_header_context_is_stripped(self):
+        patch = ('@@ -10,3 +10,3 @@ PS_SERIALIZER_DECODE_FUNC(php) /* {{{ */\n x();\n'
+                 '@@ -40 +40 @@ int g() // tail\n y();\n'
+                 '@@ -50 +50 @@ int h() /* open\n z();')
+        self.assertEqual(remove_comments(patch),
+                         '@@ -10,3 +10,3 @@ PS_SERIALIZER_DECODE_FUNC(php) \n x();\n'
+                         '@@ -40 +40 @@ int g() \n y();\n'
+                         '@@ -50 +50 @@ int h() \n z();')
+
+    def test_no_newline_marker_kept(self):
+        patch = '@@ -1 +1 @@\n-a; // x\n\\ No newline at end of file\n+b;'
+        self.assertEqual(remove_comments(patch), '@@ -1 +1 @@\n-a; \n\\ No newline at end of file\n+b;')
+
+
+if __name__ == '__main__':
+    unittest.main()
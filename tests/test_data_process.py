@@ -0,0 +1,107 @@
+import gzip
+import json
+import multiprocessing
+import os
+import shutil
+import tempfile
+import unittest
+from unittest import mock
+
+import numpy as np
+from more_itertools import chunked
+
+import data_process
+
+
+# 改写之前的 preprocess_test_data, 作为输出的参照
+def reference_preprocess_test_data(data_dir, language, test_batch_size):
+    path = os.path.join(data_dir, '{}_test_0.jsonl.gz'.format(language))
+    with gzip.open(path, 'r') as pf:
+        data = pf.readlines()
+
+    idxs = np.arange(len(data))
+    data = np.array(data, dtype=object)
+
+    np.random.seed(0)
+    np.random.shuffle(idxs)
+    data = data[idxs]
+    batched_data = chunked(data, test_batch_size)
+
+    for batch_idx, batch_data in enumerate(batched_data):
+        if len(batch_data) < test_batch_size:
+            break
+        examples = []
+        for d_idx, d in enumerate(batch_data):
+            line_a = json.loads(str(d, encoding='utf-8'))
+            doc_token = ' '.join(line_a['docstring_tokens'])
+            for dd in batch_data:
+                line_b = json.loads(str(dd, encoding='utf-8'))
+                code_token = ' '.join([data_process.format_str(token) for token in line_b['code_tokens']])
+
+                example = (str(1), line_a['url'], line_b['url'], doc_token, code_token)
+                example = '<CODESPLIT>'.join(example)
+                examples.append(example)
+
+        data_path = os.path.join(data_dir, 'test/{}'.format(language))
+        if not os.path.exists(data_path):
+            os.makedirs(data_path)
+        file_path = os.path.join(data_path, 'batch_{}.txt'.format(batch_idx))
+        with open(file_path, 'w', encoding='utf-8') as f:
+            f.writelines('\n'.join(examples))
+
+
+def write_corpus(data_dir, language, count):
+    with gzip.open(os.path.join(data_dir, '{}_test_0.jsonl.gz'.format(language)), 'wb') as f:
+        for i in range(count):
+            record = {'url': 'https://example.com/{}/{}'.format(language, i),
+                      'docstring_tokens': ['doc', str(i), 'ünïcode'],
+                      'code_tokens': ['def', 'f{}'.format(i), '(\r\n)', 'a\nb', 'c\rd', '"s"']}
+            f.write((json.dumps(record) + '\n').encode('utf-8'))
+
+
+class PreprocessTestDataTest(unittest.TestCase):
+    def setUp(self):
+        self.old_dir = tempfile.mkdtemp()
+        self.new_dir = tempfile.mkdtemp()
+        for data_dir in (self.old_dir, self.new_dir):
+            for language in ('go', 'ruby'):
+                write_corpus(data_dir, language, 47)
+
+    def tearDown(self):
+        shutil.rmtree(self.old_dir)
+        shutil.rmtree(self.new_dir)
+
+    def assert_batches_match_reference(self):
+        for language in ('go', 'ruby'):
+            reference_preprocess_test_data(self.old_dir, language, 10)
+        for language in ('go', 'ruby'):
+            old_path = os.path.join(self.old_dir, 'test', language)
+            new_path = os.path.join(self.new_dir, 'test', language)
+            # 47 条记录, batch 10: 4 个完整 batch, 最后一个不完整的丢掉
+            self.assertEqual(sorted(os.listdir(old_path)), ['batch_{}.txt'.format(i) for i in range(4)])
+            self.assertEqual(sorted(os.listdir(new_path)), sorted(os.listdir(old_path)))
+            for name in os.listdir(old_path):
+                with open(os.path.join(old_path, name), 'rb') as f:
+                    expected = f.read()
+                with open(os.path.join(new_path, name), 'rb') as f:
+                    self.assertEqual(f.read(), expected, name)
+
+    def test_batches_are_byte_identical(self):
+        data_process.preprocess_languages(['go', 'ruby'], test_batch_size=10, workers=2, data_dir=self.new_dir)
+        self.assert_batches_match_reference()
+
+    def test_single_language(self):
+        for language in ('go', 'ruby'):
+            data_process.preprocess_test_data(language, test_batch_size=10, workers=2, data_dir=self.new_dir)
+        self.assert_batches_match_reference()
+
+    def test_spawned_workers(self):
+        # spawn 启动的子进程重新导入模块, 只能从任务里拿到输出目录
+        spawn = multiprocessing.get_context('spawn')
+        with mock.patch.object(data_process, 'Pool', spawn.Pool):
+            data_process.preprocess_languages(['go', 'ruby'], test_batch_size=10, workers=2, data_dir=self.new_dir)
+        self.assert_batches_match_reference()
+
+
+if __name__ == '__main__':
+    unittest.main()
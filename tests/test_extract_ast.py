@@ -0,0 +1,67 @@
+import os
+import shutil
+import tempfile
+import unittest
+
+import extract_ast
+
+# 同名函数在 #ifdef 的两个分支里各定义一次, 标注在第二个定义里
+SOURCE = '''#ifdef HAVE_A
+static int decode(int n)
+{
+    return n;
+}
+#else
+static int decode(int n)
+{
+    return n + 1; // BUG_0A1B(1)
+}
+#endif
+'''
+
+TARGET = '''#ifdef HAVE_A
+static int decode(int n)
+{
+    return n;
+}
+#else
+static int decode(int n)
+{
+    if (n < 0)
+        return 0; // FIX_0A1B(1)
+    return n + 1;
+}
+#endif
+'''
+
+
+class ExtractPairTest(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.mkdtemp()
+        self.pair = []
+        for name, text in (('source', SOURCE), ('target', TARGET)):
+            os.mkdir(os.path.join(self.tmp, name))
+            path = os.path.join(self.tmp, name, 'dup.c')
+            with open(path, 'w') as f:
+                f.write(text)
+            self.pair.append(path)
+
+    def tearDown(self):
+        shutil.rmtree(self.tmp)
+
+    def test_duplicate_definitions_use_annotated_span(self):
+        filename, records = extract_ast.extract_pair(tuple(self.pair))
+        self.assertEqual(filename, 'dup.c')
+        self.assertEqual(len(records), 1)
+        record = records[0]
+        self.assertEqual(record['function'], 'decode')
+        self.assertEqual((record['buggy']['start'], record['buggy']['end']), (7, 10))
+        self.assertEqual((record['fixed']['start'], record['fixed']['end']), (7, 12))
+        self.assertEqual(record['buggy']['sites'], [[9, 1]])
+        self.assertEqual(record['fixed']['sites'], [[10, 1]])
+        self.assertNotIn('error', record['buggy'])
+        self.assertNotIn('error', record['fixed'])
+
+
+if __name__ == '__main__':
+    unittest.main()
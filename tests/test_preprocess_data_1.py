@@ -0,0 +1,102 @@
+import csv
+import os
+import random
+import shutil
+import tempfile
+import unittest
+
+import pandas as pd
+
+import preprocess_data_1
+from preprocess_data_1 import COLUMNS, SEPARATOR
+
+
+# 改写之前的 preprocess_data (逐行 df.append), 作为参照; 新版 pandas 没有 df.append, 用 concat 代替
+def reference_preprocess_data(src, dst):
+    df = pd.read_csv(src, header=None, skiprows=1)
+    df.columns = COLUMNS
+    df = df[['cve_id', 'summary', 'files_changed']]
+
+    for index, item in enumerate(df['files_changed']):
+        content_str = SEPARATOR
+        originalstr = item
+        position = 0
+        t = 1
+        if type(originalstr) != str:
+            df = df.drop(index=[index])
+            continue
+        p = originalstr.find(content_str, position)
+        pre = p
+        while t != -1 and p != -1:
+            p = originalstr.find(content_str, position)
+            position = p + len(content_str)
+            t = originalstr.find(content_str, position)
+            if t == -1:
+                curStr = originalstr[position:]
+            else:
+                curStr = originalstr[position:t]
+            df2 = pd.DataFrame([[df.loc[index, 'cve_id'], curStr, df.loc[index, 'summary']]])
+            df = pd.concat([df, df2])
+
+        if pre != -1:
+            item = item[0:pre]
+            df.loc[index, 'files_changed'] = item
+
+    df.to_csv(dst)
+
+
+def write_input(path, count):
+    random.seed(3)
+    with open(path, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(COLUMNS)
+        for i in range(count):
+            row = ['x%d' % j for j in range(len(COLUMNS))]
+            row[3] = 'CVE-%d' % i
+            row[11] = 'summary, "quoted"\n%d' % i if i % 7 else ''
+            # 第 0 行不能有分隔符: 旧代码在重复的 index 0 上会出错, 见 user-120 的提交说明
+            pieces = 1 if i == 0 else random.choice([1, 1, 2, 3, 5])
+            parts = ['{"sha": "%d-%d", "patch": "a\\nb,c"}' % (i, j) for j in range(pieces)]
+            if i % 11 == 5:
+                parts.append('')
+            row[17] = SEPARATOR.join(parts) if i % 13 != 4 else ''
+            writer.writerow(row)
+
+
+class PreprocessDataTest(unittest.TestCase):
+    def setUp(self):
+        self.tmp = tempfile.mkdtemp()
+        self.src = os.path.join(self.tmp, 'vul_data.csv')
+        write_input(self.src, 300)
+
+    def tearDown(self):
+        shutil.rmtree(self.tmp)
+
+    def path(self, name):
+        return os.path.join(self.tmp, name)
+
+    def test_rows_match_reference(self):
+        reference_preprocess_data(self.src, self.path('old.csv'))
+        preprocess_data_1.preprocess_data(self.src, self.path('new.csv'))
+
+        with open(self.path('new.csv')) as f:
+            self.assertEqual(f.readline().strip(), ',0,1,2,cve_id,files_changed,summary')
+        # 旧代码在当时的 pandas 下列是排过序的, 这里按 vul_data_1.csv 的列顺序比较
+        old = pd.read_csv(self.path('old.csv'), index_col=0)[['0', '1', '2', 'cve_id', 'files_changed', 'summary']]
+        new = pd.read_csv(self.path('new.csv'), index_col=0)
+        self.assertEqual(len(new), len(old))
+        self.assertTrue((new.index == old.index).all())
+        pd.testing.assert_frame_equal(new, old)
+
+    def test_chunked_output_is_byte_identical(self):
+        preprocess_data_1.preprocess_data(self.src, self.path('new.csv'))
+        with open(self.path('new.csv'), 'rb') as f:
+            expected = f.read()
+        for chunksize in (1, 17, 1000):
+            preprocess_data_1.preprocess_data(self.src, self.path('chunk.csv'), chunksize=chunksize)
+            with open(self.path('chunk.csv'), 'rb') as f:
+                self.assertEqual(f.read(), expected, chunksize)
+
+
+if __name__ == '__main__':
+    unittest.main()